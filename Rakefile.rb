@@ -20,12 +20,17 @@ build_target :debug do
     cp 'test.rb', "#{@build_target.name}/test.rb"
   end
 
+  file "#{@build_target.name}/bench.rb" => 'bench.rb' do
+    cp 'bench.rb', "#{@build_target.name}/bench.rb"
+  end
+
   file "#{@build_target.name}/#{$RUBYDLL}" => "#{$RUBY}/bin/#{$RUBYDLL}" do
     cp "#{$RUBY}/bin/#{$RUBYDLL}", "#{@build_target.name}/#{$RUBYDLL}"
   end
 
   compile do
     depend "#{@build_target.name}/test.rb"
+    depend "#{@build_target.name}/bench.rb"
     depend "#{@build_target.name}/#{$RUBYDLL}"
     flags "-std=c++11", "-fpermissive"
     define 'DEBUG'
@@ -34,7 +39,7 @@ build_target :debug do
       "#{$RUBY}/include/ruby-2.0.0",
       "#{$RUBY}/include/ruby-2.0.0/x64-mingw32",
     ]
-    sources ["src/rubydo.cpp", "src/ruby_class.cpp", "src/ruby_module.cpp"]
+    sources ["src/rubydo.cpp", "src/ruby_class.cpp", "src/ruby_module.cpp", "src/exceptions.cpp", "src/ruby_columnar_class.cpp"]
   end
 
   link do
@@ -52,6 +57,7 @@ build_target :release, :debug do
     clear_dependencies
     undefine 'DEBUG'
     define 'RELEASE'
+    flags "-O3"
   end
 
   link do
@@ -59,6 +65,16 @@ build_target :release, :debug do
   end
 end
 
+# Bench Configuration
+# ===================
+# The debug build, optimized, for `rubydo.exe bench`
+
+build_target :bench, :debug do
+  compile do
+    flags "-O2"
+  end
+end
+
 # Clean Task
 # ==========
 
@@ -66,4 +82,5 @@ desc "Clean all build targets"
 task :clean do
   rm_rf 'debug' if File.exists? 'debug'
   rm_rf 'release' if File.exists? 'release'
+  rm_rf 'bench' if File.exists? 'bench'
 end
@@ -0,0 +1,75 @@
+require 'benchmark'
+
+# Per-call cost of rubydo methods with and without exception bridging, as
+# seen from ruby. The method lookup each call goes through hides the
+# difference; rubydo.exe prints the C++-side timings before running this.
+# Run with `rubydo.exe bench` from the bench build directory (`rake bench:build`).
+
+N = 1_000_000
+
+Benchmark.bm(20) do |bm|
+  bm.report("noexcept (no bridge)") { N.times { RubydoBench.noexcept_method } }
+  bm.report("bridged (try/catch)") { N.times { RubydoBench.bridged_method } }
+  bm.report("manual rb_protect") { N.times { RubydoBench.rb_protect_method } }
+end
+
+# Memory, GC and aggregate cost of a million records as plain ruby objects
+# vs rows of a RubyColumnarClass
+
+require 'objspace'
+
+class BenchTick
+  attr_accessor :price, :volume
+
+  def initialize(price, volume)
+    @price = price
+    @volume = volume
+  end
+end
+
+ROWS = 1_000_000
+
+def live_slots
+  GC.stat[:heap_live_slots] || GC.stat[:heap_live_num]
+end
+
+# Returns the block's result along with the object slots and bytes
+# (as reported by ObjectSpace) it left alive
+def retained
+  GC.start
+  slots, bytes = live_slots, ObjectSpace.memsize_of_all
+  result = yield
+  GC.start
+  [result, live_slots - slots, ObjectSpace.memsize_of_all - bytes]
+end
+
+def gc_time
+  Benchmark.realtime { GC.start }
+end
+
+def report(label, slots, bytes, gc_seconds)
+  printf("%-28s %10d slots %12d bytes   GC.start %.4fs\n", label, slots, bytes, gc_seconds)
+end
+
+# Column storage is on the C++ heap where ObjectSpace can't see it, so it's
+# added from the class's own count of the bytes allocated for its columns
+column_bytes = RubydoBenchTick.memsize
+
+# Columnar rows first, while no ruby objects are alive
+_, slots, bytes = retained { ROWS.times { |i| RubydoBenchTick.new(i * 0.5, i) }; nil }
+column_bytes = RubydoBenchTick.memsize - column_bytes
+report("columnar rows", slots, bytes + column_bytes, gc_time)
+
+# Each live handle is a full object slot, so the savings are lost while
+# handles to every row are kept around
+handles, slots, bytes = retained { Array.new(ROWS) { |i| RubydoBenchTick.at(i) } }
+report("columnar rows + live handles", slots, bytes + column_bytes, gc_time)
+handles = nil
+
+ticks, slots, bytes = retained { Array.new(ROWS) { |i| BenchTick.new(i * 0.5, i) } }
+report("ruby objects", slots, bytes, gc_time)
+
+Benchmark.bm(20) do |bm|
+  bm.report("ruby objects sum") { 10.times { ticks.inject(0.0) { |sum, t| sum + t.price } } }
+  bm.report("columnar sum") { 10.times { RubydoBenchTick.sum(:price) } }
+end
@@ -40,8 +40,10 @@ namespace internal {
 }
 
 #ifndef RUBYDO_NO_CONFLICTS
+#include "rubydo/exceptions.h"
 #include "rubydo/ruby_module.h"
 #include "rubydo/ruby_class.h"
+#include "rubydo/ruby_columnar_class.h"
 #endif
 
 #endif
@@ -0,0 +1,193 @@
+#ifndef RUBYDOEXCEPTIONS_H
+#define RUBYDOEXCEPTIONS_H
+
+#include "ruby.h"
+#include "rubydo.h"
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace rubydo {
+
+  // Thrown by rubydo::protect when ruby raises (or throws/breaks) out of the
+  // protected block. Unwinding as a C++ exception lets destructors run, and the
+  // original ruby exception is re-raised once it reaches a rubydo method.
+  class RubyException : public std::exception {
+  public:
+    // The ruby exception object (Qnil for non-exception jumps like throw/break)
+    VALUE exception = Qnil;
+
+    // The rb_protect state, used to resume non-exception jumps
+    int state = 0;
+
+    RubyException(VALUE exception, int state);
+    RubyException(const RubyException& other);
+    RubyException& operator=(const RubyException& other) = delete;
+    virtual ~RubyException() noexcept;
+
+    virtual const char* what() const noexcept;
+
+  private:
+    std::string message;
+  };
+
+  // Produces a ruby exception for the given C++ exception, or returns Qundef
+  // if it isn't handled. Translators are run under rb_protect and outside of
+  // any catch block, so they may call into ruby.
+  typedef std::function<VALUE(const std::exception_ptr& error)> ExceptionTranslator;
+
+  // Runs `func` under rb_protect, throwing a rubydo::RubyException if ruby
+  // raises. Use this around ruby calls made from lambdas that hold objects
+  // with destructors, so that ruby's longjmp doesn't skip over them. Those
+  // lambdas must not be declared noexcept, or the exception calls std::terminate.
+  VALUE protect(std::function<VALUE()> func);
+
+  namespace internal {
+
+    void add_exception_translator(ExceptionTranslator translator);
+
+    // Returns the ruby exception to raise for `error`, or sets `state` to a
+    // pending non-exception jump. Must be called *outside* of a catch block,
+    // since the translators call into ruby. Takes `error` by value so the
+    // caller's exception_ptr is empty before anything is raised.
+    VALUE translate_exception(std::exception_ptr error, int& state);
+
+    // Raises the result of translate_exception
+    void raise_translated_exception(VALUE exception, int state);
+
+    inline std::string
+    exception_message (const std::exception& ex, std::true_type /* is std::exception */) {
+      return ex.what();
+    }
+
+    template <class ExceptionType>
+    std::string
+    exception_message (const ExceptionType& ex, std::false_type /* is std::exception */) {
+      return "unhandled C++ exception";
+    }
+
+    // Lambdas declared noexcept can't throw, so they are used as-is. That
+    // includes the RubyException from rubydo::protect, so this path is only
+    // for lambdas that never call it.
+    template <class Lambda>
+    std::function<VALUE(VALUE self, int argc, VALUE* argv)>
+    bridge_exceptions (Lambda method, std::true_type /* is noexcept */) {
+      return method;
+    }
+
+    // Anything else gets a try/catch which costs nothing until something is thrown
+    template <class Lambda>
+    std::function<VALUE(VALUE self, int argc, VALUE* argv)>
+    bridge_exceptions (Lambda method, std::false_type /* is noexcept */) {
+      return [method](VALUE self, int argc, VALUE* argv) mutable -> VALUE {
+        std::exception_ptr error;
+        try {
+          return method(self, argc, argv);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        int state = 0;
+        VALUE exception = translate_exception(std::move(error), state);
+        raise_translated_exception(exception, state);
+        return Qnil;
+      };
+    }
+
+    // Chooses between the above at compile time
+    template <class Lambda>
+    std::function<VALUE(VALUE self, int argc, VALUE* argv)>
+    bridge_exceptions (Lambda method) {
+      typedef std::integral_constant<bool,
+        noexcept(std::declval<Lambda&>()(std::declval<VALUE>(), std::declval<int>(), std::declval<VALUE*>()))
+      > is_noexcept;
+      return bridge_exceptions(std::move(method), is_noexcept());
+    }
+  }
+
+  // map_exception
+  // -------------
+  // Raises C++ exceptions of type `ExceptionType` (and subclasses) thrown from
+  // rubydo methods as instances of the ruby class `rb_exception_class`. The
+  // message is taken from what() for std::exception types. Mappings registered
+  // later take precedence over earlier ones, including the defaults:
+  //
+  //    std::exception        => RuntimeError
+  //    std::invalid_argument => ArgumentError
+  //    std::out_of_range     => IndexError
+  //    std::bad_alloc        => NoMemoryError
+  //
+  // EXAMPLE:
+  //
+  //    rubydo::map_exception<std::domain_error>(rb_eRangeError);
+  // -------------
+  template <class ExceptionType>
+  void
+  map_exception (VALUE rb_exception_class) {
+    rb_gc_register_mark_object(rb_exception_class);
+    internal::add_exception_translator([rb_exception_class](const std::exception_ptr& error) -> VALUE {
+      bool matched = false;
+      std::string message;
+      try {
+        std::rethrow_exception(error);
+      } catch (const ExceptionType& ex) {
+        matched = true;
+        message = internal::exception_message(ex, std::is_base_of<std::exception, ExceptionType>());
+      } catch (...) {
+      }
+
+      if (!matched) {
+        return Qundef;
+      }
+      return rb_exc_new(rb_exception_class, message.c_str(), message.size());
+    });
+  }
+
+  // Same as above, but `translate` builds the ruby exception object itself.
+  // It receives a copy of the thrown exception as an `ExceptionType`, so the
+  // type must be copy constructible. If `translate` raises, the C++ exception
+  // is raised as a RuntimeError.
+  //
+  // EXAMPLE:
+  //
+  //    rubydo::map_exception<HttpError>([](const HttpError& err) {
+  //      return rb_exc_new_cstr(rb_eIOError, err.reason().c_str());
+  //    });
+  template <class ExceptionType>
+  void
+  map_exception (std::function<VALUE(const ExceptionType&)> translate) {
+    internal::add_exception_translator([translate](const std::exception_ptr& error) -> VALUE {
+      // std::rethrow_exception may throw a copy of the exception (MSVC does),
+      // which is destroyed at the end of the catch block, so keep our own.
+      std::unique_ptr<ExceptionType> matched;
+      try {
+        std::rethrow_exception(error);
+      } catch (const ExceptionType& ex) {
+        matched.reset(new ExceptionType(ex));
+      } catch (...) {
+      }
+
+      if (!matched) {
+        return Qundef;
+      }
+
+      // A raise in `translate` is turned into a C++ exception so the copy is
+      // freed before the raise is passed on
+      VALUE raised = Qnil;
+      int state = 0;
+      try {
+        return protect([&]() { return translate(*matched); });
+      } catch (const RubyException& ex) {
+        raised = ex.exception;
+        state = ex.state;
+      }
+      matched.reset();
+      internal::raise_translated_exception(raised, state);
+      return Qnil;
+    });
+  }
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef RUBYCOLUMNARCLASS_H
+#define RUBYCOLUMNARCLASS_H
+
+#include "ruby.h"
+#include "rubydo.h"
+#include "rubydo/ruby_class.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rubydo {
+
+  namespace internal {
+
+    // Conversions between column element types and ruby VALUEs. `Sum` is the
+    // type columns are summed into, wide enough that millions of rows don't
+    // overflow (integers) or lose the small values (floats).
+    template <class T> struct ColumnType;
+
+    template <> struct ColumnType<double> {
+      typedef double Sum;
+      static VALUE to_ruby (double value) { return DBL2NUM(value); }
+      static double from_ruby (VALUE value) { return NUM2DBL(value); }
+    };
+
+    template <> struct ColumnType<float> {
+      typedef double Sum;
+      static VALUE to_ruby (float value) { return DBL2NUM(value); }
+      static float from_ruby (VALUE value) { return (float)NUM2DBL(value); }
+    };
+
+    template <> struct ColumnType<int32_t> {
+      typedef int64_t Sum;
+      static VALUE to_ruby (int32_t value) { return INT2NUM(value); }
+      static int32_t from_ruby (VALUE value) { return NUM2INT(value); }
+    };
+
+    template <> struct ColumnType<int64_t> {
+      typedef int64_t Sum;
+      static VALUE to_ruby (int64_t value) { return LL2NUM(value); }
+      static int64_t from_ruby (VALUE value) { return NUM2LL(value); }
+    };
+
+    // Sums into several independent accumulators so the compiler can keep them
+    // in one vector register (floating point adds can't otherwise be reordered).
+    template <class T, class Sum = typename ColumnType<T>::Sum>
+    Sum
+    sum_values (const T* values, size_t count) {
+      const size_t lane_count = 8;
+      Sum lanes[lane_count] = {};
+      size_t i = 0;
+
+      for (; i + lane_count <= count; i += lane_count) {
+        for (size_t lane = 0; lane < lane_count; ++lane) {
+          lanes[lane] += values[i + lane];
+        }
+      }
+
+      Sum total = Sum();
+      for (; i < count; ++i) {
+        total += values[i];
+      }
+      for (size_t lane = 0; lane < lane_count; ++lane) {
+        total += lanes[lane];
+      }
+      return total;
+    }
+  }
+
+  // Contiguous storage for the attributes of a RubyColumnarClass.
+  // Row `i` of every column holds the attributes of the instance at index `i`.
+  class ColumnStore {
+  public:
+
+    // A value converted for a row that hasn't been added yet. Owned by the
+    // caller of ColumnStore::add_row, so that conversions which call back into
+    // ruby (to_f, to_int) and create instances of their own can't clobber it.
+    class StagedValue {
+    public:
+      virtual ~StagedValue () {}
+    };
+
+    class ColumnBase {
+    public:
+      std::string name;
+
+      virtual ~ColumnBase () {}
+      virtual void push_default () = 0;
+      virtual std::unique_ptr<StagedValue> stage (VALUE value) = 0;
+      virtual void push_staged (const StagedValue& staged) = 0;
+      virtual void set (size_t row, VALUE value) = 0;
+      virtual VALUE sum () = 0;
+
+      // Bytes allocated for the column's values, including spare capacity
+      virtual size_t memsize () = 0;
+    };
+
+    template <class T>
+    class Staged : public StagedValue {
+    public:
+      T value;
+
+      Staged (T value) : value(value) {}
+    };
+
+    template <class T>
+    class Column : public ColumnBase {
+    public:
+      std::vector<T> values;
+      std::mutex* mutex;
+
+      Column (std::string name, std::mutex* mutex, size_t rows) : values(rows), mutex(mutex) {
+        this->name = name;
+      }
+
+      virtual void push_default () {
+        values.push_back(T());
+      }
+
+      // Converting can raise (longjmp), so it's done before any row is added
+      virtual std::unique_ptr<StagedValue> stage (VALUE value) {
+        return std::unique_ptr<StagedValue>(new Staged<T>(internal::ColumnType<T>::from_ruby(value)));
+      }
+
+      virtual void push_staged (const StagedValue& staged) {
+        values.push_back(static_cast<const Staged<T>&>(staged).value);
+      }
+
+      // Throws std::out_of_range for a row that isn't in this column, such as
+      // a handle to an instance of some other columnar class
+      T& at (size_t row) {
+        if (row >= values.size()) {
+          throw std::out_of_range("row " + std::to_string(row) + " is not in column '" + name + "'");
+        }
+        return values[row];
+      }
+
+      // Converts before locking, since a failed conversion raises (longjmps)
+      virtual void set (size_t row, VALUE value) {
+        T converted = internal::ColumnType<T>::from_ruby(value);
+        std::lock_guard<std::mutex> lock(*mutex);
+        at(row) = converted;
+      }
+
+      virtual size_t memsize () {
+        return values.capacity() * sizeof(T);
+      }
+
+      virtual VALUE sum () {
+        typedef typename internal::ColumnType<T>::Sum Sum;
+        return internal::ColumnType<Sum>::to_ruby(total());
+      }
+
+      // Sums the column without the GVL
+      typename internal::ColumnType<T>::Sum
+      total () {
+        typename internal::ColumnType<T>::Sum result = 0;
+        rubydo::without_gvl([&]() {
+          std::lock_guard<std::mutex> lock(*mutex);
+          result = internal::sum_values(values.data(), values.size());
+        }, [](){});
+        return result;
+      }
+    };
+
+    // Held by bulk operations running without the GVL, and by ruby-side writes,
+    // so that a column isn't modified (or reallocated) while it's being scanned.
+    std::mutex mutex;
+
+    std::vector<std::unique_ptr<ColumnBase>> columns;
+
+    size_t rows = 0;
+
+    ColumnBase* find_column (const std::string& name);
+
+    // Adds a row using `staged` for the first columns (in order) and defaults
+    // for the rest. Returns the new row's index.
+    size_t add_row (const std::vector<std::unique_ptr<StagedValue>>& staged);
+
+    // Bytes allocated for all of the columns' values
+    size_t memsize ();
+
+    // Returns the named column, throwing std::invalid_argument if it
+    // doesn't exist or holds a different element type.
+    template <class T>
+    Column<T>&
+    column (const std::string& name) {
+      Column<T>* typed_column = dynamic_cast<Column<T>*>(find_column(name));
+      if (typed_column == nullptr) {
+        throw std::invalid_argument("no column '" + name + "' of the requested type");
+      }
+      return *typed_column;
+    }
+
+    // Adds a column, or returns the existing one when a class is re-opened
+    template <class T>
+    Column<T>&
+    add_column (const std::string& name) {
+      if (find_column(name) != nullptr) {
+        return column<T>(name);
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      Column<T>* new_column = new Column<T>(name, &mutex, rows);
+      columns.push_back(std::unique_ptr<ColumnBase>(new_column));
+      return *new_column;
+    }
+  };
+
+  // A RubyClass whose instances are small handles (a row index) into a
+  // ColumnStore rather than objects carrying their own instance variables.
+  // Attribute accessors are generated for each column, and whole columns can
+  // be scanned from C++ without the GVL. A columnar class defined with another
+  // columnar class as its superclass shares that class's columns and rows, and
+  // can't define columns of its own.
+  //
+  // EXAMPLE:
+  //
+  //    auto tick_class = RubyColumnarClass::define("Tick")
+  //      .define_column<double>("price")
+  //      .define_column<int64_t>("volume");
+  //
+  //    /* ruby: Tick.new(101.5, 300).price => 101.5 */
+  //
+  //    double total = tick_class.sum<double>("price");
+  //    auto big = tick_class.filter<int64_t>("volume", [](int64_t v) { return v > 1000; });
+  class RubyColumnarClass : public RubyClass {
+    friend void rubydo::init(int argc, char** argv);
+
+  public:
+    static RubyColumnarClass define (std::string name, VALUE superclass = rb_cObject);
+    static RubyColumnarClass define (VALUE outter_module, std::string name, VALUE superclass = rb_cObject);
+
+    // Shared by every instance of the class, owned by the ruby class object
+    ColumnStore* store = nullptr;
+
+    // True for a subclass using its superclass's store
+    bool shares_superclass_store = false;
+
+    // Defines a column of type T (double, float, int32_t or int64_t) along with
+    // `name` and `name=` instance methods. Columns are filled in order by the
+    // arguments to `new`; missing arguments default to zero. Throws
+    // std::logic_error on a class that shares its superclass's store, since the
+    // column would be added to the superclass as well.
+    template <class T>
+    RubyColumnarClass&
+    define_column (std::string name) {
+      if (shares_superclass_store) {
+        throw std::logic_error("can't define column '" + name + "' on " + this->name + ", it shares its superclass's columns");
+      }
+      ColumnStore::Column<T>* column = &store->add_column<T>(name);
+
+      define_method(name, [column](VALUE self, int argc, VALUE* argv) -> VALUE {
+        return internal::ColumnType<T>::to_ruby(column->at(row_of(self)));
+      });
+
+      define_method(name + "=", [column](VALUE self, int argc, VALUE* argv) -> VALUE {
+        if (argc != 1) {
+          throw std::invalid_argument("wrong number of arguments (expected 1)");
+        }
+        column->set(row_of(self), argv[0]);
+        return argv[0];
+      });
+
+      return *this;
+    }
+
+    // Number of rows (instances created)
+    size_t size ();
+
+    // Returns a handle to the given row
+    VALUE at (size_t row);
+
+    // Bytes allocated for the columns (also `memsize` in ruby). This memory
+    // is invisible to ObjectSpace and the GC.
+    size_t memsize ();
+
+    // Returns the row index of an instance
+    static size_t row_of (VALUE handle);
+
+    // Bulk operations. These release the GVL while scanning the column, so
+    // predicates must not call into ruby.
+
+    // Sums are returned as int64_t for integer columns and double for floating point
+    template <class T>
+    typename internal::ColumnType<T>::Sum
+    sum (std::string column) {
+      return store->column<T>(column).total();
+    }
+
+    // Returns the indices of rows whose value in `column` satisfies `pred`
+    template <class T, class Predicate>
+    std::vector<size_t>
+    filter (std::string column, Predicate pred) {
+      ColumnStore::Column<T>& typed_column = store->column<T>(column);
+      std::vector<size_t> matches;
+
+      rubydo::without_gvl([&]() {
+        std::lock_guard<std::mutex> lock(store->mutex);
+        const T* values = typed_column.values.data();
+        size_t count = typed_column.values.size();
+        for (size_t i = 0; i < count; ++i) {
+          if (pred(values[i])) {
+            matches.push_back(i);
+          }
+        }
+      }, [](){});
+
+      return matches;
+    }
+
+    // Returns row indices ordered by their value in `column`. Rows themselves
+    // aren't moved, so existing handles stay valid.
+    template <class T>
+    std::vector<size_t>
+    sort (std::string column) {
+      ColumnStore::Column<T>& typed_column = store->column<T>(column);
+      std::vector<size_t> order;
+
+      rubydo::without_gvl([&]() {
+        std::lock_guard<std::mutex> lock(store->mutex);
+        const std::vector<T>& values = typed_column.values;
+        order.resize(values.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+          order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&values](size_t a, size_t b) {
+          return values[a] < values[b];
+        });
+      }, [](){});
+
+      return order;
+    }
+
+  protected:
+    static const std::string column_store_iv_name;
+
+    // Initialized in rubydo::init
+    static VALUE cRubydoColumnStore;
+
+    static VALUE allocate_handle (VALUE klass);
+    static VALUE wrap_row (VALUE klass, ColumnStore* store, size_t row);
+
+    RubyColumnarClass (std::string name, VALUE superclass = rb_cObject);
+    RubyColumnarClass (VALUE outter_module, std::string name, VALUE superclass = rb_cObject);
+
+    void init_column_store ();
+    void define_store_singleton_methods ();
+  };
+}
+
+#endif
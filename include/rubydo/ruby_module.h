@@ -3,6 +3,7 @@
 
 #include "ruby.h"
 #include "rubydo.h"
+#include "rubydo/exceptions.h"
 #include <string>
 
 namespace rubydo {
@@ -64,9 +65,18 @@ namespace rubydo {
     RubyModule define_module(std::string name);
     RubyClass define_class(std::string name, VALUE superclass = rb_cObject);
     
-    // define_method returns the ruby module to allow method chaining
-    RubyModule& define_method(std::string name, Method method);
-    RubyModule& define_singleton_method(std::string name, Method method);
+    // define_method returns the ruby module to allow method chaining.
+    // C++ exceptions thrown by `method` are raised as ruby exceptions (see
+    // rubydo::map_exception). Lambdas declared noexcept skip the try/catch.
+    template <class Lambda>
+    RubyModule& define_method(std::string name, Lambda method) {
+      return define_bridged_method(name, internal::bridge_exceptions(std::move(method)));
+    }
+    
+    template <class Lambda>
+    RubyModule& define_singleton_method(std::string name, Lambda method) {
+      return define_bridged_singleton_method(name, internal::bridge_exceptions(std::move(method)));
+    }
     
     VALUE get_instance_method_lookup_table();
     VALUE get_singleton_method_lookup_table();
@@ -79,6 +89,10 @@ namespace rubydo {
     
     void init_rb_module();
     
+    // Registers a Method that has already been wrapped by internal::bridge_exceptions
+    RubyModule& define_bridged_method(std::string name, Method method);
+    RubyModule& define_bridged_singleton_method(std::string name, Method method);
+    
     // Defines this module in the ruby world
     // (Overridden by RubyClass)
     virtual void rb_define_self();
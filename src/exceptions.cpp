@@ -0,0 +1,182 @@
+#include "rubydo.h"
+#include "rubydo/exceptions.h"
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rubydo;
+
+namespace {
+
+  // rb_protect state for a raised exception (TAG_RAISE in ruby's eval_intern.h).
+  // Any other state is a throw/break/next etc. whose data lives in errinfo and
+  // must be left there for rb_jump_tag to resume.
+  const int tag_raise = 0x6;
+
+  VALUE invoke_protected (VALUE arg) {
+    return (*((std::function<VALUE()>*)arg))();
+  }
+
+  struct TranslatorCall {
+    ExceptionTranslator* translator;
+    std::exception_ptr* error;
+  };
+
+  VALUE invoke_translator (VALUE arg) {
+    TranslatorCall* call = (TranslatorCall*)arg;
+    return (*call->translator)(*call->error);
+  }
+
+  VALUE get_exception_message (VALUE exception) {
+    return rb_funcall(exception, rb_intern("message"), 0);
+  }
+
+  // Registered translators, searched from most to least recently added.
+  // The defaults are installed on first use so user mappings always follow them.
+  vector<ExceptionTranslator>& get_exception_translators () {
+    static vector<ExceptionTranslator> translators;
+    static bool initialized = false;
+
+    if (!initialized) {
+      initialized = true;
+      map_exception<std::exception>(rb_eRuntimeError);
+      map_exception<std::invalid_argument>(rb_eArgError);
+      map_exception<std::out_of_range>(rb_eIndexError);
+      map_exception<std::bad_alloc>(rb_eNoMemError);
+    }
+
+    return translators;
+  }
+}
+
+namespace rubydo {
+
+  // RubyException
+  // -------------
+  // The exception VALUE is registered with the GC while the C++ exception
+  // is in flight, since nothing on the ruby side references it anymore.
+  // -------------
+  RubyException::RubyException (VALUE exception, int state) {
+    this->exception = exception;
+    this->state = state;
+    rb_gc_register_address(&this->exception);
+
+    if (NIL_P(exception)) {
+      message = "ruby non-local jump";
+    } else {
+      int message_state = 0;
+      VALUE rb_message = rb_protect(get_exception_message, exception, &message_state);
+      if (message_state || !RB_TYPE_P(rb_message, T_STRING)) {
+        rb_set_errinfo(Qnil);
+        message = "ruby exception";
+      } else {
+        message = std::string(RSTRING_PTR(rb_message), RSTRING_LEN(rb_message));
+      }
+    }
+  }
+
+  RubyException::RubyException (const RubyException& other) : std::exception(other) {
+    this->exception = other.exception;
+    this->state = other.state;
+    this->message = other.message;
+    rb_gc_register_address(&this->exception);
+  }
+
+  RubyException::~RubyException () noexcept {
+    rb_gc_unregister_address(&this->exception);
+  }
+
+  const char*
+  RubyException::what () const noexcept {
+    return message.c_str();
+  }
+
+  // protect
+  // -------
+  // Runs `func` under rb_protect. If ruby raises, the error info is cleared and
+  // a rubydo::RubyException is thrown in its place. When the exception reaches
+  // a rubydo method the original ruby exception is raised again (or, for a
+  // break/throw out of a block, the jump is resumed).
+  //
+  // The lambda calling `protect` must not be declared noexcept. Those skip the
+  // exception bridging, so the RubyException would call std::terminate.
+  //
+  // EXAMPLE:
+  //
+  //    rubydo_class.define_method("each_line", [](VALUE self, int argc, VALUE* argv) {
+  //      std::ifstream file(path);  /* closed even if the block raises */
+  //      std::string line;
+  //      while (std::getline(file, line)) {
+  //        rubydo::protect([&]() {
+  //          return rb_yield(rb_str_new_cstr(line.c_str()));
+  //        });
+  //      }
+  //      return self;
+  //    });
+  // -------
+  VALUE
+  protect (std::function<VALUE()> func) {
+    int state = 0;
+    VALUE result = rb_protect(invoke_protected, (VALUE)&func, &state);
+
+    if (state) {
+      VALUE exception = Qnil;
+      if (state == tag_raise) {
+        exception = rb_errinfo();
+        rb_set_errinfo(Qnil);
+      }
+      throw RubyException(exception, state);
+    }
+
+    return result;
+  }
+
+  namespace internal {
+
+    void
+    add_exception_translator (ExceptionTranslator translator) {
+      get_exception_translators().push_back(translator);
+    }
+
+    VALUE
+    translate_exception (std::exception_ptr error, int& state) {
+      try {
+        std::rethrow_exception(error);
+      } catch (const RubyException& ex) {
+        // Came from rubydo::protect, pass the original through untouched
+        state = ex.state;
+        return ex.exception;
+      } catch (...) {
+        // Fall through to the registered translators
+      }
+
+      auto& translators = get_exception_translators();
+      for (auto it = translators.rbegin(); it != translators.rend(); ++it) {
+        TranslatorCall call = { &(*it), &error };
+        int translator_state = 0;
+        VALUE exception = rb_protect(invoke_translator, (VALUE)&call, &translator_state);
+
+        if (translator_state) {
+          // The translator itself raised, fall back to a plain RuntimeError
+          rb_set_errinfo(Qnil);
+          break;
+        }
+        if (exception != Qundef) {
+          return exception;
+        }
+      }
+
+      return rb_exc_new_cstr(rb_eRuntimeError, "unhandled C++ exception");
+    }
+
+    void
+    raise_translated_exception (VALUE exception, int state) {
+      if (NIL_P(exception) && state) {
+        rb_jump_tag(state);
+      }
+      rb_exc_raise(exception);
+    }
+  }
+}
@@ -0,0 +1,260 @@
+#include "rubydo.h"
+#include "rubydo/ruby_columnar_class.h"
+#include <string>
+
+using namespace std;
+
+namespace {
+  std::string
+  get_column_name (VALUE name) {
+    VALUE name_string = rb_funcall(name, rb_intern("to_s"), 0);
+    return std::string(StringValueCStr(name_string));
+  }
+
+  // Handles are created on demand, so two handles are the same record when
+  // they have the same row of the same store, whichever subclass they're from.
+  // `owner` is the class that created the store.
+  VALUE
+  same_row (VALUE owner, VALUE self, int argc, VALUE* argv) {
+    if (argc != 1) {
+      rb_raise(rb_eArgError, "wrong number of arguments (%d for 1)", argc);
+    }
+    VALUE other = argv[0];
+    bool same = RTEST(rb_obj_is_kind_of(other, owner)) && DATA_PTR(self) == DATA_PTR(other);
+    return same ? Qtrue : Qfalse;
+  }
+}
+
+namespace rubydo {
+
+  // ColumnStore
+  // -----------
+
+  ColumnStore::ColumnBase*
+  ColumnStore::find_column (const std::string& name) {
+    for (auto& column : columns) {
+      if (column->name == name) {
+        return column.get();
+      }
+    }
+    return nullptr;
+  }
+
+  size_t
+  ColumnStore::add_row (const std::vector<std::unique_ptr<StagedValue>>& staged) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < columns.size(); ++i) {
+      if (i < staged.size()) {
+        columns[i]->push_staged(*staged[i]);
+      } else {
+        columns[i]->push_default();
+      }
+    }
+    return rows++;
+  }
+
+  size_t
+  ColumnStore::memsize () {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (auto& column : columns) {
+      bytes += column->memsize();
+    }
+    return bytes;
+  }
+
+  // Static Members
+  // --------------
+
+  const string
+  RubyColumnarClass::column_store_iv_name = "rubydo_column_store";
+
+  VALUE
+  RubyColumnarClass::cRubydoColumnStore = Qnil;
+
+  // Instances start out as empty handles, `initialize` assigns them a row.
+  // The row is stored in the data pointer offset by one, so NULL means unassigned.
+  VALUE
+  RubyColumnarClass::allocate_handle (VALUE klass) {
+    return Data_Wrap_Struct(klass, NULL, NULL, NULL);
+  }
+
+  VALUE
+  RubyColumnarClass::wrap_row (VALUE klass, ColumnStore* store, size_t row) {
+    if (row >= store->rows) {
+      throw std::out_of_range("row " + std::to_string(row) + " out of range");
+    }
+    return Data_Wrap_Struct(klass, NULL, NULL, (void*)(row + 1));
+  }
+
+  size_t
+  RubyColumnarClass::row_of (VALUE handle) {
+    void* data = DATA_PTR(handle);
+    if (data == NULL) {
+      throw std::logic_error("columnar object was not initialized");
+    }
+    return (size_t)data - 1;
+  }
+
+  // Instance Members
+  // ----------------
+
+  RubyColumnarClass::RubyColumnarClass (std::string name, VALUE superclass) : RubyClass(name, superclass) {
+  }
+
+  RubyColumnarClass
+  RubyColumnarClass::define (std::string name, VALUE superclass) {
+    RubyColumnarClass columnar_class(name, superclass);
+    columnar_class.init_rb_module();
+    columnar_class.init_column_store();
+    return columnar_class;
+  }
+
+  RubyColumnarClass::RubyColumnarClass (VALUE outter_module, std::string name, VALUE superclass) : RubyClass(outter_module, name, superclass) {
+  }
+
+  RubyColumnarClass
+  RubyColumnarClass::define (VALUE outter_module, std::string name, VALUE superclass) {
+    RubyColumnarClass columnar_class(outter_module, name, superclass);
+    columnar_class.init_rb_module();
+    columnar_class.init_column_store();
+    return columnar_class;
+  }
+
+  // Finds the ColumnStore of a re-opened class, or creates it along with the
+  // allocator and the methods that don't depend on the columns.
+  void
+  RubyColumnarClass::init_column_store () {
+    VALUE actual_superclass = rb_class_superclass(self);
+    VALUE superclass_store = NIL_P(actual_superclass) ? Qnil : rb_iv_get(actual_superclass, column_store_iv_name.c_str());
+
+    VALUE boxed_store = rb_iv_get(self, column_store_iv_name.c_str());
+    if (RTEST(boxed_store)) {
+      Data_Get_Struct(boxed_store, ColumnStore, store);
+      shares_superclass_store = boxed_store == superclass_store;
+      return;
+    }
+
+    // A subclass of a columnar class inherits its accessors, which index the
+    // superclass's columns, so its rows have to live in the same store.
+    if (RTEST(superclass_store)) {
+      Data_Get_Struct(superclass_store, ColumnStore, store);
+      shares_superclass_store = true;
+      rb_iv_set(self, column_store_iv_name.c_str(), superclass_store);
+      define_store_singleton_methods();
+      return;
+    }
+
+    store = new ColumnStore();
+    boxed_store = Data_Wrap_Struct(cRubydoColumnStore, NULL, internal::deleter<ColumnStore*>, store);
+    rb_iv_set(self, column_store_iv_name.c_str(), boxed_store);
+
+    rb_define_alloc_func(self, allocate_handle);
+
+    ColumnStore* store = this->store;
+    VALUE owner = self;
+
+    define_method("initialize", [store](VALUE self, int argc, VALUE* argv) -> VALUE {
+      // Would add a row and move the handle to it
+      if (DATA_PTR(self) != NULL) {
+        rb_raise(rb_eTypeError, "columnar object is already initialized");
+      }
+      if ((size_t)argc > store->columns.size()) {
+        throw std::invalid_argument("more arguments than columns");
+      }
+
+      // Convert everything first so a bad argument doesn't leave a row behind.
+      // Conversions can raise, so they're protected to free what's been staged.
+      std::vector<std::unique_ptr<ColumnStore::StagedValue>> staged;
+      for (int i = 0; i < argc; ++i) {
+        rubydo::protect([&]() {
+          staged.push_back(store->columns[i]->stage(argv[i]));
+          return Qnil;
+        });
+      }
+
+      size_t row = store->add_row(staged);
+      DATA_PTR(self) = (void*)(row + 1);
+      return self;
+    });
+
+    // dup and clone allocate an empty handle, pointing it at the original's row here
+    define_method("initialize_copy", [owner](VALUE self, int argc, VALUE* argv) noexcept {
+      if (argc != 1) {
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 1)", argc);
+      }
+      VALUE original = argv[0];
+      if (!RTEST(rb_obj_is_kind_of(original, owner)) || DATA_PTR(original) == NULL) {
+        rb_raise(rb_eTypeError, "can't copy from an uninitialized or unrelated object");
+      }
+      DATA_PTR(self) = DATA_PTR(original);
+      return self;
+    });
+
+    define_method("==", [owner](VALUE self, int argc, VALUE* argv) noexcept {
+      return same_row(owner, self, argc, argv);
+    });
+
+    define_method("eql?", [owner](VALUE self, int argc, VALUE* argv) noexcept {
+      return same_row(owner, self, argc, argv);
+    });
+
+    define_method("hash", [owner](VALUE self, int argc, VALUE* argv) noexcept {
+      st_index_t hash = rb_hash_start((st_index_t)owner);
+      hash = rb_hash_uint(hash, (st_index_t)DATA_PTR(self));
+      return LONG2FIX((long)rb_hash_end(hash));
+    });
+
+    define_store_singleton_methods();
+  }
+
+  // Ruby inherits these like any class method, but rubydo's invoke_singleton_method
+  // reads the implementation from the lookup table of `self`, which a subclass
+  // doesn't have. So subclasses sharing a store define them again.
+  void
+  RubyColumnarClass::define_store_singleton_methods () {
+    ColumnStore* store = this->store;
+
+    define_singleton_method("size", [store](VALUE self, int argc, VALUE* argv) noexcept {
+      return SIZET2NUM(store->rows);
+    });
+
+    define_singleton_method("at", [store](VALUE self, int argc, VALUE* argv) -> VALUE {
+      if (argc != 1) {
+        throw std::invalid_argument("wrong number of arguments (expected 1)");
+      }
+      return wrap_row(self, store, NUM2SIZET(argv[0]));
+    });
+
+    define_singleton_method("memsize", [store](VALUE self, int argc, VALUE* argv) noexcept {
+      return SIZET2NUM(store->memsize());
+    });
+
+    define_singleton_method("sum", [store](VALUE self, int argc, VALUE* argv) -> VALUE {
+      if (argc != 1) {
+        throw std::invalid_argument("wrong number of arguments (expected 1)");
+      }
+      std::string name = get_column_name(argv[0]);
+      ColumnStore::ColumnBase* column = store->find_column(name);
+      if (column == nullptr) {
+        throw std::invalid_argument("no column '" + name + "'");
+      }
+      return column->sum();
+    });
+  }
+
+  size_t
+  RubyColumnarClass::size () {
+    return store->rows;
+  }
+
+  VALUE
+  RubyColumnarClass::at (size_t row) {
+    return wrap_row(self, store, row);
+  }
+
+  size_t
+  RubyColumnarClass::memsize () {
+    return store->memsize();
+  }
+}
@@ -50,7 +50,7 @@ namespace rubydo {
     rubydo::RubyModule::MethodWrapper* method_wrapper_ptr;
     Data_Get_Struct(boxed_method_wrapper, rubydo::RubyModule::MethodWrapper, method_wrapper_ptr);
     
-    // TODO: try/catch around this and raise a ruby exception to
+    // C++ exceptions were bridged when the method was defined
     return method_wrapper_ptr->implementation(self, argc, argv);
   }
   
@@ -65,7 +65,7 @@ namespace rubydo {
     rubydo::RubyModule::MethodWrapper* method_wrapper_ptr;
     Data_Get_Struct(boxed_method_wrapper, rubydo::RubyModule::MethodWrapper, method_wrapper_ptr);
     
-    // TODO: try/catch around this and raise a ruby exception to
+    // C++ exceptions were bridged when the method was defined
     return method_wrapper_ptr->implementation(self, argc, argv);
   }
 
@@ -200,7 +200,7 @@ namespace rubydo {
   }
 
   RubyModule& 
-  RubyModule::define_method (std::string name, Method method) {
+  RubyModule::define_bridged_method (std::string name, Method method) {
     rb_define_method(self, name.c_str(), RubyModule::invoke_instance_method, -1); /* -1 => send argc & argv */
     
     // Wrap implementation in struct
@@ -219,7 +219,7 @@ namespace rubydo {
   }
 
   RubyModule& 
-  RubyModule::define_singleton_method (std::string name, Method method) {
+  RubyModule::define_bridged_singleton_method (std::string name, Method method) {
     rb_define_singleton_method(self, name.c_str(), RubyModule::invoke_singleton_method, -1); /* -1 => send argc & argv */
     
     // Wrap implementation in struct
@@ -2,10 +2,14 @@
 #include "rubydo/ruby_class.h"
 #include "ruby.h"
 #include "ruby/thread.h"
+#include <exception>
 #include <functional>
 
 #ifdef DEBUG
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
+#include <cstring>
 #endif
 
 // Helper functions
@@ -27,6 +31,35 @@ namespace {
     return NULL;
   }
 
+  // Exceptions can't unwind through ruby's C frames, so without_gvl
+  // catches them here and rethrows once the GVL is held again.
+  struct WithoutGvlCall {
+    RUBYDO_BLOCK* func;
+    RUBYDO_BLOCK* ubf;
+    std::exception_ptr error;
+  };
+
+  void* invoke_catching_exceptions(void* arg) {
+    auto call = (WithoutGvlCall*)arg;
+    try {
+      (*call->func)();
+    } catch (...) {
+      call->error = std::current_exception();
+    }
+    return NULL;
+  }
+
+  VALUE call_without_gvl(VALUE arg) {
+    auto call = (WithoutGvlCall*)arg;
+    rb_thread_call_without_gvl(invoke_catching_exceptions, call, invoke, call->ubf);
+    return Qnil;
+  }
+
+  VALUE restore_thread_has_gvl(VALUE arg) {
+    thread_has_gvl = true;
+    return Qnil;
+  }
+
   VALUE invoke_and_destroy_returning_qnil (void* arg) {
     if (arg != NULL) {
       auto block_ptr = (RUBYDO_BLOCK*)arg;
@@ -52,6 +85,9 @@ namespace rubydo {
     
     // Initialize the ruby class used to box Method objects in.
     RubyModule::cRubydoMethod = rb_define_class("RubydoMethod", rb_cObject);
+    
+    // Initialize the ruby class used to box the column storage of RubyColumnarClasses
+    RubyColumnarClass::cRubydoColumnStore = rb_define_class("RubydoColumnStore", rb_cObject);
   }
   
   // use_ruby_standard_library
@@ -73,6 +109,8 @@ namespace rubydo {
   // has been given, or the thread is killed) then `ubf` will be called. `ubf`
   // is then responsible for unblocking `func` by some means.
   //
+  // C++ exceptions thrown by `func` are rethrown after the GVL is re-obtained.
+  //
   // EXAMPLE:
   //
   //    /* Running some code with the GVL... */
@@ -87,8 +125,15 @@ namespace rubydo {
   // -----------
   void 
   without_gvl(RUBYDO_BLOCK func, RUBYDO_BLOCK ubf) {
+    WithoutGvlCall call = { &func, &ubf, std::exception_ptr() };
     thread_has_gvl = false;
-    rb_thread_call_without_gvl(invoke_returning_null_ptr, &func, invoke, &ubf);
+    
+    // rb_ensure, since ruby may raise on an interrupt once the GVL is back
+    rb_ensure(call_without_gvl, (VALUE)&call, restore_thread_has_gvl, Qnil);
+    
+    if (call.error) {
+      std::rethrow_exception(call.error);
+    }
   }
 
   // with_gvl
@@ -110,6 +155,7 @@ namespace rubydo {
     if (!thread_has_gvl){
       thread_has_gvl = true;
       rb_thread_call_with_gvl(invoke_returning_null_ptr, &func);
+      thread_has_gvl = false;
     } else {
       (func)();
     }
@@ -131,6 +177,11 @@ namespace rubydo {
   
   void test_thread();
   VALUE make_int_update_thread(int &var, int new_val);
+  void define_exception_tests();
+  void define_exception_benchmarks();
+  void bench_exception_bridging();
+  void test_columnar_class();
+  void define_columnar_benchmarks();
 
   int main(int argc, char** argv) {
     rubydo::init(argc, argv);
@@ -197,8 +248,18 @@ namespace rubydo {
       .define_method("deeply_nested_method", [](VALUE self, int argc, VALUE* argv){
         return rb_str_new_cstr("success");
       });
-      
-    rb_require("./test.rb");
+    
+    define_exception_tests();
+    test_columnar_class();
+    
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      bench_exception_bridging();
+      define_exception_benchmarks();
+      define_columnar_benchmarks();
+      rb_require("./bench.rb");
+    } else {
+      rb_require("./test.rb");
+    }
   }
 
   void test_thread() {
@@ -213,4 +274,168 @@ namespace rubydo {
       var = new_val;
     });
   }
+  
+  struct RubydoTestError : public std::runtime_error {
+    RubydoTestError() : std::runtime_error("rubydo test error") {}
+  };
+  
+  struct RubydoUntranslatableError {};
+  
+  struct RubydoCodedError {
+    std::string code;
+    RubydoCodedError(std::string code) : code(code) {}
+  };
+  
+  bool guard_destroyed = false;
+  
+  struct Guard {
+    ~Guard() { guard_destroyed = true; }
+  };
+  
+  void define_exception_tests() {
+    rubydo::map_exception<RubydoTestError>(rb_eTypeError);
+    rubydo::map_exception<RubydoUntranslatableError>([](const RubydoUntranslatableError& err) -> VALUE {
+      rb_raise(rb_eTypeError, "translator raised");
+      return Qnil;
+    });
+    
+    rubydo::map_exception<RubydoCodedError>([](const RubydoCodedError& err) {
+      return rb_exc_new_cstr(rb_eIOError, err.code.c_str());
+    });
+    
+    RubyClass::define("RubydoExceptions")
+      .define_singleton_method("throw_runtime_error", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw std::runtime_error("thrown from C++");
+      })
+      .define_singleton_method("throw_out_of_range", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw std::out_of_range("out of range");
+      })
+      .define_singleton_method("throw_mapped_error", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw RubydoTestError();
+      })
+      .define_singleton_method("throw_int", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw 42;
+      })
+      .define_singleton_method("throw_coded_error", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw RubydoCodedError("coded error");
+      })
+      .define_singleton_method("throw_untranslatable", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        throw RubydoUntranslatableError();
+      })
+      .define_singleton_method("raise_through_guard", [](VALUE self, int argc, VALUE* argv) -> VALUE {
+        Guard guard;
+        guard_destroyed = false;
+        return rubydo::protect([&]() {
+          return rb_funcall(self, rb_intern("raise"), 1, rb_str_new_cstr("raised from ruby"));
+        });
+      })
+      .define_singleton_method("guard_destroyed?", [](VALUE self, int argc, VALUE* argv) noexcept {
+        return guard_destroyed ? Qtrue : Qfalse;
+      });
+  }
+  
+  void define_exception_benchmarks() {
+    RubyClass::define("RubydoBench")
+      .define_singleton_method("noexcept_method", [](VALUE self, int argc, VALUE* argv) noexcept {
+        return Qnil;
+      })
+      .define_singleton_method("bridged_method", [](VALUE self, int argc, VALUE* argv) {
+        return Qnil;
+      })
+      .define_singleton_method("rb_protect_method", [](VALUE self, int argc, VALUE* argv) noexcept {
+        // What bindings had to do by hand before bridging: a setjmp on every call
+        int state = 0;
+        VALUE result = rb_protect([](VALUE arg) { return Qnil; }, Qnil, &state);
+        if (state) rb_jump_tag(state);
+        return result;
+      });
+  }
+  
+  typedef std::function<VALUE(VALUE self, int argc, VALUE* argv)> BenchMethod;
+  
+  // Keeps the optimizer from dropping the calls
+  volatile VALUE bench_sink;
+  
+  void time_bench_method(const char* label, const BenchMethod& method) {
+    const int calls = 10000000;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) {
+      bench_sink = method((VALUE)i, 0, NULL);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << label << ": " << elapsed.count() << "s per " << calls << " calls" << endl;
+  }
+  
+  // Calls the method implementations the way invoke_instance_method does, without
+  // the method lookup that dominates a call from ruby. Build the bench target
+  // (-O2) for meaningful numbers.
+  void bench_exception_bridging() {
+    time_bench_method("raw lambda", [](VALUE self, int argc, VALUE* argv) {
+      return self;
+    });
+    time_bench_method("noexcept (no bridge)", internal::bridge_exceptions([](VALUE self, int argc, VALUE* argv) noexcept {
+      return self;
+    }));
+    time_bench_method("bridged (try/catch)", internal::bridge_exceptions([](VALUE self, int argc, VALUE* argv) {
+      return self;
+    }));
+    time_bench_method("manual rb_protect", [](VALUE self, int argc, VALUE* argv) {
+      int state = 0;
+      VALUE result = rb_protect([](VALUE arg) { return arg; }, self, &state);
+      if (state) rb_jump_tag(state);
+      return result;
+    });
+  }
+  
+  void test_columnar_class() {
+    auto tick_class = RubyColumnarClass::define("RubydoTick")
+      .define_column<double>("price")
+      .define_column<int64_t>("volume");
+    
+    rb_funcall(tick_class.self, rb_intern("new"), 2, DBL2NUM(3.0), INT2NUM(100));
+    rb_funcall(tick_class.self, rb_intern("new"), 2, DBL2NUM(1.0), INT2NUM(2000));
+    rb_funcall(tick_class.self, rb_intern("new"), 2, DBL2NUM(2.0), INT2NUM(300));
+    
+    bool sum_ok = tick_class.sum<double>("price") == 6.0 && tick_class.sum<int64_t>("volume") == 2400;
+    cout << (sum_ok ? "Succeeded" : "Failed") << ": Summing columnar class columns" << endl;
+    
+    auto big = tick_class.filter<int64_t>("volume", [](int64_t volume) { return volume > 1000; });
+    bool filter_ok = big.size() == 1 && big[0] == 1;
+    cout << (filter_ok ? "Succeeded" : "Failed") << ": Filtering a columnar class column" << endl;
+    
+    auto order = tick_class.sort<double>("price");
+    bool sort_ok = order.size() == 3 && order[0] == 1 && order[1] == 2 && order[2] == 0;
+    cout << (sort_ok ? "Succeeded" : "Failed") << ": Sorting a columnar class column" << endl;
+    
+    bool rethrown = false;
+    try {
+      tick_class.filter<double>("price", [](double price) -> bool { throw std::runtime_error("predicate"); });
+    } catch (const std::runtime_error& ex) {
+      rethrown = true;
+    }
+    
+    // The GVL flag must be restored too, or with_gvl would try to re-acquire the GVL
+    bool ran_with_gvl = false;
+    rubydo::with_gvl([&]() { ran_with_gvl = true; });
+    cout << ((rethrown && ran_with_gvl) ? "Succeeded" : "Failed") << ": Rethrowing exceptions from without_gvl" << endl;
+    
+    RubyColumnarClass::define("RubydoQuantity")
+      .define_column<int32_t>("quantity");
+    
+    // Shares RubydoTick's rows, so it can't add columns (they'd be added to RubydoTick too)
+    auto sub_tick_class = RubyColumnarClass::define("RubydoSubTick", tick_class.self);
+    bool column_rejected = false;
+    try {
+      sub_tick_class.define_column<int32_t>("flags");
+    } catch (const std::logic_error& ex) {
+      column_rejected = true;
+    }
+    cout << (column_rejected ? "Succeeded" : "Failed") << ": Rejecting columns on a columnar subclass" << endl;
+  }
+  
+  void define_columnar_benchmarks() {
+    RubyColumnarClass::define("RubydoBenchTick")
+      .define_column<double>("price")
+      .define_column<int64_t>("volume");
+  }
 #endif
@@ -80,6 +80,178 @@ begin
     c2.deeply_nested_method == "success"
   end
   
+  test "C++ exception raised as ruby RuntimeError" do
+    begin
+      RubydoExceptions.throw_runtime_error
+      false
+    rescue RuntimeError => ex
+      ex.message == "thrown from C++"
+    end
+  end
+  
+  test "Default exception mapping (std::out_of_range => IndexError)" do
+    begin
+      RubydoExceptions.throw_out_of_range
+      false
+    rescue IndexError => ex
+      ex.message == "out of range"
+    end
+  end
+  
+  test "Custom exception mapping" do
+    begin
+      RubydoExceptions.throw_mapped_error
+      false
+    rescue TypeError => ex
+      ex.message == "rubydo test error"
+    end
+  end
+  
+  test "C++ exception mapped by a translator" do
+    begin
+      RubydoExceptions.throw_coded_error
+      false
+    rescue IOError => ex
+      ex.message == "coded error"
+    end
+  end
+  
+  test "Non std::exception C++ exception" do
+    begin
+      RubydoExceptions.throw_int
+      false
+    rescue RuntimeError
+      true
+    end
+  end
+  
+  test "Exception translator that raises falls back to RuntimeError" do
+    begin
+      RubydoExceptions.throw_untranslatable
+      false
+    rescue RuntimeError => ex
+      ex.message == "unhandled C++ exception"
+    end
+  end
+  
+  test "Ruby exception through rubydo::protect runs C++ destructors" do
+    begin
+      RubydoExceptions.raise_through_guard
+      false
+    rescue RuntimeError => ex
+      ex.message == "raised from ruby" && RubydoExceptions.guard_destroyed?
+    end
+  end
+  
+  test "Columnar class instances read their row" do
+    tick = RubydoTick.at(0)
+    tick.price == 3.0 && tick.volume == 100
+  end
+  
+  test "Columnar class instances created from ruby" do
+    tick = RubydoTick.new(4.5, 10)
+    RubydoTick.size == 4 && tick.price == 4.5 && RubydoTick.at(3) == tick
+  end
+  
+  test "Columnar class handles work as hash keys" do
+    { RubydoTick.at(0) => 1 }[RubydoTick.at(0)] == 1 &&
+      RubydoTick.at(0).eql?(RubydoTick.at(0)) &&
+      !RubydoTick.at(0).eql?(RubydoTick.at(1)) &&
+      [RubydoTick.at(1), RubydoTick.at(1)].uniq.size == 1
+  end
+  
+  test "Columnar class attribute writers" do
+    tick = RubydoTick.at(3)
+    tick.volume = 20
+    RubydoTick.at(3).volume == 20
+  end
+  
+  test "Columnar class column sum from ruby" do
+    RubydoTick.sum(:volume) == 2420 && RubydoTick.sum("price") == 10.5
+  end
+  
+  test "Columnar class reports its column memory" do
+    RubydoTick.memsize >= RubydoTick.size * 16
+  end
+  
+  test "Columnar class int32 column sums without overflow" do
+    i = 0
+    while i < 3000
+      RubydoQuantity.new(1_000_000)
+      i += 1
+    end
+    RubydoQuantity.sum(:quantity) == 3_000_000_000
+  end
+  
+  test "Columnar class bad arguments don't add a row" do
+    size = RubydoTick.size
+    begin
+      RubydoTick.new(1.0, "not a number")
+      false
+    rescue TypeError
+      RubydoTick.size == size
+    end
+  end
+  
+  test "Columnar class initialize is re-entrant" do
+    volume = Object.new
+    def volume.to_int
+      RubydoTick.new(77.0, 1)
+      5
+    end
+    tick = RubydoTick.new(1.0, volume)
+    tick.price == 1.0 && tick.volume == 5 && RubydoTick.at(RubydoTick.size - 2).price == 77.0
+  end
+  
+  test "Columnar class handles can be copied" do
+    tick = RubydoTick.at(0)
+    copy = tick.dup
+    copy.price == tick.price && copy.volume == tick.volume && copy == tick
+  end
+  
+  test "Columnar class handles can't be initialized twice" do
+    tick = RubydoTick.at(0)
+    size = RubydoTick.size
+    begin
+      tick.send(:initialize, 5.0, 5)
+      false
+    rescue TypeError
+      RubydoTick.size == size && tick == RubydoTick.at(0)
+    end
+  end
+  
+  test "Columnar class row out of range" do
+    begin
+      RubydoTick.at(100)
+      false
+    rescue IndexError
+      true
+    end
+  end
+  
+  test "Columnar subclass shares its superclass's rows" do
+    sub_tick = RubydoSubTick.new(9.0, 5)
+    sub_tick.price == 9.0 && RubydoTick.at(RubydoTick.size - 1).price == 9.0 &&
+      RubydoTick.at(RubydoTick.size - 1) == sub_tick &&
+      RubydoSubTick.at(0).hash == RubydoTick.at(0).hash
+  end
+  
+  test "Columnar subclass leaves its superclass unchanged" do
+    too_many_arguments = begin
+      RubydoTick.new(1.0, 2, 3)
+      false
+    rescue ArgumentError
+      true
+    end
+    no_flags_column = begin
+      RubydoTick.sum(:flags)
+      false
+    rescue ArgumentError
+      true
+    end
+    too_many_arguments && no_flags_column && !RubydoTick.method_defined?(:flags)
+  end
+  
 rescue Exception => ex
   puts ex
   puts ex.backtrace